@@ -0,0 +1,1476 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <optional>
+#include <print>
+#include <ranges>
+#include <span>
+#include <unordered_map>
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <mutex>
+#include <thread>
+#include <typeindex>
+
+template <typename ...>
+struct ComponentList;
+
+// CONCEPT
+template <typename>
+struct IsComponentType : std::false_type {};
+
+template <typename ... Components>
+struct IsComponentType<ComponentList<Components ...>> : std::true_type {};
+
+template <typename Type>
+concept ComponentListType = IsComponentType<Type>::value;
+
+// Shared components are stored once per archetype and compared to pick the archetype
+template <typename Type>
+concept SharedComponentType = std::equality_comparable<Type> && std::copy_constructible<Type> && requires(const Type& value) {
+    { std::hash<Type>{}(value) } -> std::convertible_to<std::size_t>;
+};
+
+template<typename... Components>
+struct EntityBuilder;
+
+template <typename...>
+struct TypeList {};
+
+// Position of Search in Types or sizeof...(Types) when missing; a single fold instead of one recursion per type
+template<typename Search, typename... Types>
+consteval std::size_t getTypeIndex() {
+    std::size_t index = 0;
+    (void)((std::is_same_v<Search, Types> ? false : (++index, true)) && ...);
+    return index;
+}
+
+template<std::size_t Index, typename Type>
+struct ValueListElement {
+    Type value;
+};
+
+template<typename Indices, typename... Types>
+struct ValueListBase;
+
+// Every value is a direct base, so lookups do not walk a nested head/tail chain
+template<std::size_t... Indices, typename... Types>
+struct ValueListBase<std::index_sequence<Indices...>, Types...> : ValueListElement<Indices, Types>... {
+    ValueListBase() = default;
+
+    explicit ValueListBase(Types&&... values) requires (sizeof...(Types) != 0) : ValueListElement<Indices, Types>{std::forward<Types>(values)}... {}
+};
+
+template<typename... Types>
+struct ValueList : ValueListBase<std::index_sequence_for<Types...>, Types...> {
+    using Base = ValueListBase<std::index_sequence_for<Types...>, Types...>;
+
+    ValueList() = default;
+
+    explicit ValueList(Types&&... values) requires (sizeof...(Types) != 0) : Base(std::forward<Types>(values)...) {}
+
+    template<typename Search>
+    auto& get() noexcept {
+        constexpr auto index = getTypeIndex<Search, Types...>();
+        static_assert(index < sizeof...(Types), "Type not found");
+        return static_cast<ValueListElement<index, Search>&>(*this).value;
+    }
+
+    template<typename Search>
+    auto& get() const noexcept {
+        constexpr auto index = getTypeIndex<Search, Types...>();
+        static_assert(index < sizeof...(Types), "Type not found");
+        return static_cast<const ValueListElement<index, Search>&>(*this).value;
+    }
+};
+
+template <typename... Ts>
+ValueList(Ts&&...) -> ValueList<std::decay_t<Ts>...>;
+
+// Column of Type; a const Type iterates over a const column
+template<typename Type>
+using ColumnType = std::conditional_t<std::is_const_v<Type>, const std::vector<std::remove_const_t<Type>>, std::vector<Type>>;
+
+template<typename... Components>
+struct StorageIterator {
+    template<typename Type>
+    using RangeType = decltype(std::ranges::subrange(std::declval<ColumnType<Type>&>()));
+
+    explicit StorageIterator(ColumnType<Components>&... components) : ranges(RangeType<Components>(components)...) {}
+
+    explicit StorageIterator(RangeType<Components>... componentRanges) : ranges(std::move(componentRanges)...) {}
+
+    // Iterator type for range\-based for
+    struct Iterator {
+        template<typename Type>
+        using ItType = decltype(std::declval<RangeType<Type>>().begin());
+
+        using ItList = ValueList<ItType<Components>...>;
+
+        ItList begins;
+        ItList ends;
+
+        Iterator(ItList&& b, ItList&& e) : begins(std::forward<ItList>(b)), ends(std::forward<ItList>(e)) {}
+
+        // Dereference: return tuple-like ValueList of const refs to components
+        auto operator*() const {
+            return ValueList<const Components&...>{((*begins.template get<ItType<Components>>()))...};
+        }
+
+        // Pre-increment: advance all iterators
+        Iterator& operator++() {
+            (void)std::initializer_list<int>{(++begins.template get<ItType<Components>>(), 0)...};
+            return *this;
+        }
+
+        // Compare: continue while all begins != end (stop when any reaches end)
+        bool operator!=(const Iterator& other) const {
+            return ((begins.template get<ItType<Components>>() != other.ends.template get<ItType<Components>>()) && ...);
+        }
+    };
+
+    Iterator begin() {
+        using ItList = typename Iterator::ItList;
+        return Iterator(
+            ItList{ ranges.template get<RangeType<Components>>().begin()... },
+            ItList{ ranges.template get<RangeType<Components>>().end()... }
+        );
+    }
+
+    Iterator end() {
+        using ItList = typename Iterator::ItList;
+        // end iterator uses ends for comparison; begins set to ends as well
+        return Iterator(
+            ItList{ ranges.template get<RangeType<Components>>().end()... },
+            ItList{ ranges.template get<RangeType<Components>>().end()... }
+        );
+    }
+
+private:
+    template<typename Type>
+    auto isEmpty() const noexcept {
+        const auto& range = ranges.template get<RangeType<Type>>();
+        return range.begin() == range.end();
+    }
+
+    template<typename Type>
+    void next() noexcept {
+        auto& range = ranges.template get<RangeType<Type>>();
+        range = RangeType<Type>(range.begin() + 1, range.end());
+    }
+
+    template<typename Type>
+    const auto& getCurrentRef() const noexcept {
+        const auto& range = ranges.template get<RangeType<Type>>();
+        return *range.begin();
+    }
+
+    ValueList<RangeType<Components> ...> ranges;
+};
+
+template <typename... Ts>
+StorageIterator(std::vector<Ts>&...) -> StorageIterator<std::decay_t<Ts>...>;
+
+// One archetype seen through a query: the shared value is read once, not per row
+template<typename Shared, typename... Components>
+struct SharedChunk {
+    const Shared& shared;
+    StorageIterator<Components...> rows;
+};
+
+// Archetype identity: row mask, shared mask and the shared values themselves
+template<typename... Types>
+std::size_t hashArchetype(uint64_t archetypeMask, uint64_t sharedMask, const ValueList<std::optional<Types>...>& shared) noexcept {
+    auto hash = std::hash<uint64_t>{}(archetypeMask) ^ (std::hash<uint64_t>{}(sharedMask) << 1);
+    auto combine = [&hash]<typename Type>(const std::optional<Type>& value) {
+        if constexpr (SharedComponentType<Type>) {
+            if (value.has_value()) {
+                hash ^= std::hash<Type>{}(value.value()) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+            }
+        }
+    };
+    (combine(shared.template get<std::optional<Types>>()), ...);
+    return hash;
+}
+
+template<typename... Components>
+struct EntityBuilder {
+    EntityBuilder() =  default;
+
+    template<typename Component>
+    auto& withComponent(Component&& component) noexcept {
+        components.template get<std::optional<Component>>().emplace(std::forward<Component>(component));
+        return *this;
+    }
+
+    template<SharedComponentType Component>
+    auto& withSharedComponent(Component&& component) noexcept {
+        sharedComponents.template get<std::optional<std::decay_t<Component>>>().emplace(std::forward<Component>(component));
+        return *this;
+    }
+
+    auto getArchetype() const noexcept {
+        return (getComponentBit<Components>(components) | ...);
+    }
+
+    auto getSharedArchetype() const noexcept {
+        return (getComponentBit<Components>(sharedComponents) | ...);
+    }
+
+    auto getArchetypeHash() const noexcept {
+        return hashArchetype<Components...>(getArchetype(), getSharedArchetype(), sharedComponents);
+    }
+
+    template<typename Component>
+    auto getComponentBit(const ValueList<std::optional<Components>...>& values) const noexcept {
+        auto index = ComponentList<Components...>{}.template getComponentIndex<Component>();
+        return  values.template get<std::optional<Component>>().has_value() ? (static_cast<uint64_t>(1) << index) : 0;
+    }
+
+    ValueList<std::optional<Components>...> components;
+    ValueList<std::optional<Components>...> sharedComponents;
+};
+
+// Stable keeps the row order, Unstable fills holes with rows from the end and moves less
+enum class Compaction {
+    Stable,
+    Unstable
+};
+
+// Rows added and removed since the last observer flush; added rows stay at the end of the storage
+struct ArchetypeEvents {
+    std::size_t added = 0;
+    std::size_t removed = 0;
+};
+
+template <typename ... Types>
+struct ComponentStorage {
+    template<typename... ArchetypeComponents>
+    ComponentStorage(ComponentList<ArchetypeComponents...>) : archetypeMask{ComponentList<Types...>{}.template getComponentsMask<ArchetypeComponents...>()} {}
+
+    ComponentStorage(uint64_t archetypeMask) : archetypeMask{archetypeMask} {}
+
+    explicit ComponentStorage(const EntityBuilder<Types...>& entity) : archetypeMask{entity.getArchetype()}, sharedMask{entity.getSharedArchetype()} {
+        (copyShared<Types>(entity.sharedComponents.template get<std::optional<Types>>()), ...);
+    }
+
+    auto getReferenceIterator() {
+        return StorageIterator<Types...>(getComponents<Types>()...);
+    }
+
+    template <typename... ComponentTypes>
+    auto getReferenceIterator() {
+        return StorageIterator<ComponentTypes...>(getComponents<ComponentTypes>()...);
+    }
+
+    template <typename... ComponentTypes>
+    auto getReferenceIterator() const {
+        return StorageIterator<const ComponentTypes...>(getComponents<ComponentTypes>()...);
+    }
+
+    template<typename... ArchetypeComponents>
+    void push(ArchetypeComponents&&... components) {
+        auto entityArchetype = ComponentList<Types...>{}.template getComponentsMask<ArchetypeComponents...>();
+        if (entityArchetype != archetypeMask) {
+            std::println("Error: Trying to push components that do not match the archetype mask!");
+            std::exit(EXIT_FAILURE);
+        }
+        (pushToStorage<ArchetypeComponents>(std::forward<ArchetypeComponents>(components)), ...);
+        ++events.added;
+    }
+
+    void push(EntityBuilder<Types...>&& entity) {
+        auto entityArchetype = entity.getArchetype();
+        if (entityArchetype != archetypeMask) {
+            std::println("Error: Trying to push components that do not match the archetype mask!");
+            std::exit(EXIT_FAILURE);
+        }
+        if (!matchesShared(entity)) {
+            std::println("Error: Trying to push shared components that do not match the archetype!");
+            std::exit(EXIT_FAILURE);
+        }
+        pushEntity(std::move(entity.components));
+        ++events.added;
+    }
+
+    bool matchesShared(const EntityBuilder<Types...>& entity) const noexcept {
+        return entity.getSharedArchetype() == sharedMask && (sharedEquals<Types>(entity.sharedComponents.template get<std::optional<Types>>()) && ...);
+    }
+
+    auto getArchetypeHash() const noexcept {
+        return hashArchetype<Types...>(archetypeMask, sharedMask, shared);
+    }
+
+    bool matchesShared(const ComponentStorage& other) const noexcept {
+        return other.archetypeMask == archetypeMask && other.sharedMask == sharedMask
+            && (sharedEquals<Types>(other.shared.template get<std::optional<Types>>()) && ...);
+    }
+
+    template<typename Type>
+    const Type& getShared() const noexcept {
+        return shared.template get<std::optional<Type>>().value();
+    }
+
+    std::size_t size() const noexcept {
+        return std::max({getComponents<Types>().size()...});
+    }
+
+    template<typename... RowComponents>
+    auto getRow(std::size_t row) const noexcept {
+        return ValueList<const RowComponents&...>{getComponents<RowComponents>()[row]...};
+    }
+
+    // Empty storage of the same archetype, used as a batch for moving rows around
+    auto makeEmpty() const {
+        ComponentStorage storage{archetypeMask};
+        storage.sharedMask = sharedMask;
+        (storage.template copyShared<Types>(shared.template get<std::optional<Types>>()), ...);
+        return storage;
+    }
+
+    // Moves one row into target and fills the hole with the last row
+    void moveRowTo(std::size_t row, ComponentStorage& target) {
+        auto firstAddedRow = size() - events.added;
+        if (row >= firstAddedRow) {
+            --events.added;
+        } else {
+            ++events.removed;
+            // The row lives on in target, so observers get a copy of it
+            if (removedRows) {
+                (copyRemovedComponent<Types>(row), ...);
+            }
+            // Swap with the last old row first so the added rows stay together at the end
+            if (events.added != 0 && row + 1 != firstAddedRow) {
+                swapRows(row, firstAddedRow - 1);
+                row = firstAddedRow - 1;
+            }
+        }
+        (moveComponentTo<Types>(row, target), ...);
+        ++target.events.added;
+    }
+
+    void swapRows(std::size_t first, std::size_t second) {
+        (swapComponents<Types>(first, second), ...);
+    }
+
+    // Reorders every column by key(component), all of them with the same permutation.
+    // Rows added since the last observer flush are sorted among themselves and stay at the end.
+    template<typename Component, typename Key>
+    void sortBy(Key&& key) {
+        auto keys = getSortKeys<Component>(key);
+        auto permutation = getIdentityPermutation();
+        for (auto rows : getSortSegments(permutation)) {
+            std::ranges::stable_sort(rows, {}, [&keys](std::size_t row) { return keys[row]; });
+        }
+        applyPermutation(permutation);
+    }
+
+    // Same result as sortBy but linear for rows that are already nearly sorted
+    template<typename Component, typename Key>
+    void resortBy(Key&& key) {
+        auto keys = getSortKeys<Component>(key);
+        auto permutation = getIdentityPermutation();
+        std::size_t moves = 0;
+        for (auto rows : getSortSegments(permutation)) {
+            moves += insertionSortRows(rows, keys);
+        }
+        if (moves != 0) {
+            applyPermutation(permutation);
+        }
+    }
+
+    // Sorts by key and returns the first row of every group of equal keys;
+    // groups restart at the rows added since the last observer flush
+    template<typename Component, typename Key>
+    auto groupBy(Key&& key) {
+        sortBy<Component>(key);
+        const auto& keyComponents = getComponents<Component>();
+        auto firstAddedRow = size() - events.added;
+        std::vector<std::size_t> groups;
+        for (std::size_t row = 0; row < keyComponents.size(); ++row) {
+            if (row == 0 || row == firstAddedRow || key(keyComponents[row - 1]) != key(keyComponents[row])) {
+                groups.push_back(row);
+            }
+        }
+        return groups;
+    }
+
+    // Removes every row matching the predicate; the move plan is built once and replayed on each column
+    template<typename... PredicateComponents, typename Predicate>
+    std::size_t removeIf(Predicate& predicate, Compaction compaction) {
+        auto rows = size();
+        std::vector<uint8_t> keep(rows);
+        for (std::size_t row = 0; row < rows; ++row) {
+            keep[row] = !predicate(getRow<PredicateComponents...>(row));
+        }
+        auto kept = static_cast<std::size_t>(std::ranges::count(keep, uint8_t{1}));
+        if (kept == rows) {
+            return 0;
+        }
+
+        auto firstAddedRow = rows - events.added;
+        auto removedAdded = static_cast<std::size_t>(std::count(keep.begin() + static_cast<std::ptrdiff_t>(firstAddedRow), keep.end(), uint8_t{0}));
+        events.added -= removedAdded;
+        events.removed += rows - kept - removedAdded;
+        // Rows added since the last flush were never reported, so they disappear silently
+        if (removedRows) {
+            (moveRemovedComponents<Types>(keep, firstAddedRow), ...);
+        }
+
+        // Filling holes from the end would mix rows added since the last flush with old ones
+        if (compaction == Compaction::Stable || events.added != 0) {
+            std::vector<std::pair<std::size_t, std::size_t>> keptRuns;
+            for (std::size_t row = 0; row < rows;) {
+                for (; row < rows && !keep[row]; ++row) {}
+                auto runBegin = row;
+                for (; row < rows && keep[row]; ++row) {}
+                if (runBegin != row) {
+                    keptRuns.emplace_back(runBegin, row);
+                }
+            }
+            (compactComponents<Types>(keptRuns, kept), ...);
+        } else {
+            std::vector<std::pair<std::size_t, std::size_t>> moves;
+            for (std::size_t hole = 0, last = rows; ; ++hole) {
+                for (; hole < kept && keep[hole]; ++hole) {}
+                if (hole >= kept) {
+                    break;
+                }
+                for (--last; !keep[last]; --last) {}
+                moves.emplace_back(last, hole);
+            }
+            (fillComponentHoles<Types>(moves, kept), ...);
+        }
+        return rows - kept;
+    }
+
+    // Appends rows read straight into the column memory, columns in component list order
+    bool canStreamColumns() const noexcept {
+        return sharedMask == 0 && (canStream<Types>() && ...);
+    }
+
+    void readColumns(std::istream& stream, std::size_t rows) {
+        if (!canStreamColumns()) {
+            std::println("Error: Only archetypes of trivially copyable, non shared components can be streamed!");
+            std::exit(EXIT_FAILURE);
+        }
+        (readComponents<Types>(stream, rows), ...);
+        events.added += rows;
+    }
+
+    void writeColumns(std::ostream& stream, std::size_t firstRow, std::size_t rows) const {
+        if (!canStreamColumns()) {
+            std::println("Error: Only archetypes of trivially copyable, non shared components can be streamed!");
+            std::exit(EXIT_FAILURE);
+        }
+        (writeComponents<Types>(stream, firstRow, rows), ...);
+    }
+
+    // Makes this storage a copy of the archetype with only CopiedComponents filled, reusing column capacity
+    template<typename... CopiedComponents>
+    void copyColumnsFrom(const ComponentStorage& other) {
+        archetypeMask = other.archetypeMask;
+        sharedMask = other.sharedMask;
+        (copyShared<Types>(other.shared.template get<std::optional<Types>>()), ...);
+        (clearUnless<Types, CopiedComponents...>(), ...);
+        (getComponents<CopiedComponents>().assign(other.template getComponents<CopiedComponents>().begin(), other.template getComponents<CopiedComponents>().end()), ...);
+    }
+
+    // Moves all rows of other to the end of this storage, one reserve per column
+    void append(ComponentStorage&& other) {
+        if (!matchesShared(other)) {
+            std::println("Error: Trying to append storage of a different archetype!");
+            std::exit(EXIT_FAILURE);
+        }
+        events.added += other.size();
+        (appendComponents<Types>(other.template getComponents<Types>()), ...);
+    }
+
+    ValueList<std::vector<Types>...> components;
+    uint64_t archetypeMask = {0};
+
+    // Components stored once for the whole archetype instead of per row
+    ValueList<std::optional<Types>...> shared;
+    uint64_t sharedMask = {0};
+
+    ArchetypeEvents events;
+
+    // Most a column grows per read while loading a column stream
+    static constexpr std::size_t StreamChunkBytes = std::size_t{1} << 20;
+
+    // Rows removed since the last observer flush; only kept while the world has observers
+    std::unique_ptr<ComponentStorage> removedRows;
+
+    void trackRemovedRows() {
+        if (!removedRows) {
+            removedRows = std::make_unique<ComponentStorage>(makeEmpty());
+        }
+    }
+
+    void clearEvents() {
+        events = {};
+        if (removedRows) {
+            (removedRows->template getComponents<Types>().clear(), ...);
+        }
+    }
+
+private:
+    // ComponentStorage(uint64_t archetypeMask): archetypeMask{archetypeMask} {};
+
+    template<typename Type>
+    auto& getComponents() noexcept {
+        return components.template get<std::vector<Type>>();
+    }
+
+    template<typename Type>
+    const auto& getComponents() const noexcept {
+        return components.template get<std::vector<Type>>();
+    }
+
+    void pushEntity(ValueList<std::optional<Types>...>&& components) {
+        (pushComponent(std::move(components.template get<std::optional<Types>>())), ...);
+    }
+
+    template<typename Type>
+    void pushComponent(std::optional<Type>&& component) {
+        if (component.has_value()) {
+            pushToStorage<Type>(std::forward<Type>(component.value()));
+        }
+    }
+
+    template<typename Type>
+    void pushToStorage(Type&& component) noexcept {
+        auto& componentStorage = getComponents<Type>();
+        componentStorage.emplace_back(std::forward<Type>(component));;
+    }
+
+    template<typename Component, typename Key>
+    auto getSortKeys(Key& key) const {
+        auto componentBit = ComponentList<Types...>{}.template getComponentsMask<Component>();
+        if ((archetypeMask & componentBit) == 0) {
+            std::println("Error: Trying to sort by a component missing from the archetype!");
+            std::exit(EXIT_FAILURE);
+        }
+        const auto& keyComponents = getComponents<Component>();
+        std::vector<std::decay_t<std::invoke_result_t<Key&, const Component&>>> keys;
+        keys.reserve(keyComponents.size());
+        for (const auto& component : keyComponents) {
+            keys.emplace_back(key(component));
+        }
+        return keys;
+    }
+
+    // Old rows and rows added since the last observer flush, sorted separately
+    auto getSortSegments(std::vector<std::size_t>& permutation) const {
+        auto firstAddedRow = permutation.begin() + static_cast<std::ptrdiff_t>(permutation.size() - events.added);
+        return std::array{std::span(permutation.begin(), firstAddedRow), std::span(firstAddedRow, permutation.end())};
+    }
+
+    // Falls back to stable_sort once the insertion sort moves more than a few rows per row
+    template<typename Keys>
+    std::size_t insertionSortRows(std::span<std::size_t> rows, const Keys& keys) {
+        auto moveBudget = 4 * rows.size();
+        std::size_t moves = 0;
+        for (std::size_t i = 1; i < rows.size() && moves <= moveBudget; ++i) {
+            auto row = rows[i];
+            auto j = i;
+            for (; j > 0 && keys[row] < keys[rows[j - 1]]; --j) {
+                rows[j] = rows[j - 1];
+            }
+            rows[j] = row;
+            moves += i - j;
+        }
+        if (moves > moveBudget) {
+            // Insertion sort never reorders equal keys, so the result stays stable
+            std::ranges::stable_sort(rows, {}, [&keys](std::size_t row) { return keys[row]; });
+        }
+        return moves;
+    }
+
+    auto getIdentityPermutation() const {
+        std::vector<std::size_t> permutation(size());
+        std::iota(permutation.begin(), permutation.end(), std::size_t{0});
+        return permutation;
+    }
+
+    // Permutes in place: row i receives old row permutation[i], one cycle at a time
+    void applyPermutation(const std::vector<std::size_t>& permutation) {
+        std::vector<std::size_t> cycleStarts;
+        std::vector<bool> visited(permutation.size());
+        for (std::size_t row = 0; row < permutation.size(); ++row) {
+            if (visited[row] || permutation[row] == row) {
+                continue;
+            }
+            cycleStarts.push_back(row);
+            for (auto next = row; !visited[next]; next = permutation[next]) {
+                visited[next] = true;
+            }
+        }
+        (permuteComponents<Types>(permutation, cycleStarts), ...);
+    }
+
+    template<typename Type>
+    void permuteComponents(const std::vector<std::size_t>& permutation, const std::vector<std::size_t>& cycleStarts) {
+        auto& componentStorage = getComponents<Type>();
+        if (componentStorage.empty()) {
+            return;
+        }
+        for (auto start : cycleStarts) {
+            auto first = std::move(componentStorage[start]);
+            auto row = start;
+            for (; permutation[row] != start; row = permutation[row]) {
+                componentStorage[row] = std::move(componentStorage[permutation[row]]);
+            }
+            componentStorage[row] = std::move(first);
+        }
+    }
+
+    template<typename Type>
+    void copyRemovedComponent(std::size_t row) {
+        const auto& componentStorage = getComponents<Type>();
+        if (row >= componentStorage.size()) {
+            return;
+        }
+        if constexpr (std::is_copy_constructible_v<Type>) {
+            removedRows->template getComponents<Type>().push_back(componentStorage[row]);
+        } else {
+            std::println("Error: Observed rows moved to another storage need copyable components!");
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    template<typename Type>
+    void moveRemovedComponents(const std::vector<uint8_t>& keep, std::size_t firstAddedRow) {
+        auto& componentStorage = getComponents<Type>();
+        if (componentStorage.empty()) {
+            return;
+        }
+        auto& removedComponents = removedRows->template getComponents<Type>();
+        for (std::size_t row = 0; row < firstAddedRow; ++row) {
+            if (!keep[row]) {
+                removedComponents.emplace_back(std::move(componentStorage[row]));
+            }
+        }
+    }
+
+    template<typename Type, typename... KeptComponents>
+    void clearUnless() {
+        if constexpr (!(std::is_same_v<Type, KeptComponents> || ...)) {
+            getComponents<Type>().clear();
+        }
+    }
+
+    template<typename Type>
+    void compactComponents(const std::vector<std::pair<std::size_t, std::size_t>>& keptRuns, std::size_t kept) {
+        auto& componentStorage = getComponents<Type>();
+        if (componentStorage.empty()) {
+            return;
+        }
+        std::size_t target = 0;
+        for (auto [runBegin, runEnd] : keptRuns) {
+            if (runBegin != target) {
+                if constexpr (std::is_trivially_copyable_v<Type>) {
+                    // Whole runs at once, memmove is vectorized by the standard library
+                    std::memmove(componentStorage.data() + target, componentStorage.data() + runBegin, (runEnd - runBegin) * sizeof(Type));
+                } else {
+                    std::move(componentStorage.begin() + static_cast<std::ptrdiff_t>(runBegin), componentStorage.begin() + static_cast<std::ptrdiff_t>(runEnd),
+                              componentStorage.begin() + static_cast<std::ptrdiff_t>(target));
+                }
+            }
+            target += runEnd - runBegin;
+        }
+        componentStorage.erase(componentStorage.begin() + static_cast<std::ptrdiff_t>(kept), componentStorage.end());
+    }
+
+    template<typename Type>
+    void fillComponentHoles(const std::vector<std::pair<std::size_t, std::size_t>>& moves, std::size_t kept) {
+        auto& componentStorage = getComponents<Type>();
+        if (componentStorage.empty()) {
+            return;
+        }
+        for (auto [from, to] : moves) {
+            componentStorage[to] = std::move(componentStorage[from]);
+        }
+        componentStorage.erase(componentStorage.begin() + static_cast<std::ptrdiff_t>(kept), componentStorage.end());
+    }
+
+    template<typename Type>
+    bool hasComponent() const noexcept {
+        return (archetypeMask & ComponentList<Types...>{}.template getComponentsMask<Type>()) != 0;
+    }
+
+    template<typename Type>
+    bool canStream() const noexcept {
+        return std::is_trivially_copyable_v<Type> || !hasComponent<Type>();
+    }
+
+    template<typename Type>
+    void readComponents(std::istream& stream, std::size_t rows) {
+        if constexpr (std::is_trivially_copyable_v<Type>) {
+            if (!hasComponent<Type>()) {
+                return;
+            }
+            // The row count comes from the stream, so the column only grows as the data actually arrives
+            constexpr auto chunkRows = std::max<std::size_t>(1, StreamChunkBytes / sizeof(Type));
+            auto& componentStorage = getComponents<Type>();
+            for (std::size_t readRows = 0; readRows < rows;) {
+                auto chunk = std::min(chunkRows, rows - readRows);
+                auto oldSize = componentStorage.size();
+                componentStorage.resize(oldSize + chunk);
+                auto bytes = static_cast<std::streamsize>(chunk * sizeof(Type));
+                if (!stream.read(reinterpret_cast<char*>(componentStorage.data() + oldSize), bytes)) {
+                    std::println("Error: Unexpected end of the column stream!");
+                    std::exit(EXIT_FAILURE);
+                }
+                readRows += chunk;
+            }
+        }
+    }
+
+    template<typename Type>
+    void writeComponents(std::ostream& stream, std::size_t firstRow, std::size_t rows) const {
+        if constexpr (std::is_trivially_copyable_v<Type>) {
+            if (!hasComponent<Type>()) {
+                return;
+            }
+            const auto& componentStorage = getComponents<Type>();
+            stream.write(reinterpret_cast<const char*>(componentStorage.data() + firstRow), static_cast<std::streamsize>(rows * sizeof(Type)));
+        }
+    }
+
+    template<typename Type>
+    void swapComponents(std::size_t first, std::size_t second) {
+        auto& componentStorage = getComponents<Type>();
+        if (!componentStorage.empty()) {
+            std::ranges::swap(componentStorage[first], componentStorage[second]);
+        }
+    }
+
+    template<typename Type>
+    void moveComponentTo(std::size_t row, ComponentStorage& target) {
+        auto& componentStorage = getComponents<Type>();
+        if (row >= componentStorage.size()) {
+            return;
+        }
+        target.template getComponents<Type>().emplace_back(std::move(componentStorage[row]));
+        if (row + 1 != componentStorage.size()) {
+            componentStorage[row] = std::move(componentStorage.back());
+        }
+        componentStorage.pop_back();
+    }
+
+    template<typename Type>
+    void appendComponents(std::vector<Type>& otherComponents) {
+        auto& componentStorage = getComponents<Type>();
+        componentStorage.reserve(componentStorage.size() + otherComponents.size());
+        std::ranges::move(otherComponents, std::back_inserter(componentStorage));
+        otherComponents.clear();
+    }
+
+    template<typename Type>
+    void copyShared(const std::optional<Type>& value) {
+        if constexpr (SharedComponentType<Type>) {
+            shared.template get<std::optional<Type>>() = value;
+        }
+    }
+
+    template<typename Type>
+    bool sharedEquals(const std::optional<Type>& value) const noexcept {
+        if constexpr (SharedComponentType<Type>) {
+            return shared.template get<std::optional<Type>>() == value;
+        } else {
+            return true;
+        }
+    }
+};
+
+template <typename ...>
+struct ComponentReferences;
+
+template <>
+struct ComponentReferences<> {};
+
+template <typename Type, typename ... Types>
+struct ComponentReferences<Type, Types ...> {
+    const Type& components;
+    ComponentReferences<Types ...> nextComponentReferences;
+};
+
+// COMPONENT LIST
+
+template <>
+struct ComponentList<> {
+    template <typename ... Types>
+    constexpr bool intersects(ComponentList<Types ...>) {
+        return false;
+    }
+
+    template<typename... Types>
+    constexpr uint64_t getComponentsMask() {
+        return 64;
+    }
+
+    template<typename Type>
+    constexpr uint64_t getComponentIndex() {
+        return 64;
+    }
+};
+
+template <typename Type, typename... Types>
+struct ComponentList<Type, Types...> {
+    using Storage = ComponentStorage<Type, Types ...>;
+    using References = ComponentReferences<Type, Types ...>;
+    using Entity = EntityBuilder<Type, Types...>;
+
+    template <typename... OtherTypes>
+    constexpr bool intersects(ComponentList<OtherTypes...>) {
+        return ((getTypeIndex<OtherTypes, Type, Types...>() != sizeof...(Types) + 1) || ...);
+    }
+
+   template<typename... OtherTypes>
+   constexpr uint64_t getComponentsMask() {
+       return ((static_cast<uint64_t>(1) << getComponentIndex<OtherTypes>()) | ...);
+   }
+
+    // Bits are assigned from the back of the list; 64 when OtherType is not in the list
+    template<typename OtherType>
+    constexpr uint64_t getComponentIndex() {
+        constexpr auto index = getTypeIndex<OtherType, Type, Types...>();
+        if constexpr (index == sizeof...(Types) + 1) {
+            return 64;
+        } else {
+            return sizeof...(Types) - index;
+        }
+    }
+
+    template<typename... ArchetypeComponents>
+    static auto makeArchetypeStorage() {
+        return typename Storage::ComponentStorage(ComponentList<ArchetypeComponents...>{});
+    }
+};
+
+// LIST OF COMPONENT LISTS
+template <ComponentListType ... ComponentLists>
+struct ListComponentList {
+
+    template <ComponentListType NewComponentList>
+    constexpr auto append() {
+        if constexpr (!(ComponentLists().intersects(NewComponentList{}) || ...)) {
+            return ListComponentList<NewComponentList, ComponentLists...>{};
+        }
+        else
+            static_assert(false, "Jakis error");
+    }
+};
+
+// // SYSTEM
+// template <ComponentListType ReadList, ComponentListType Components>
+// struct System {
+//     using Storage = typename Components::Storage;
+//     using References = typename Components::References;
+//
+//     void runSystem(const Storage& components) {
+//
+//     }
+//
+//     virtual bool execute(const References& references) = 0;
+//
+//     virtual ~System() = default;
+// };
+
+// All add/remove notifications of one archetype for one frame
+template<typename... Components>
+struct ObserverBatch {
+    ComponentStorage<Components...>& storage;
+    std::size_t added;
+    std::size_t removed;
+
+    // Rows added since the last flush, valid as long as the storage was not reordered.
+    // Only row components can be iterated; shared values are read with storage.getShared.
+    template<typename... AddedComponents>
+    auto getAddedIterator() {
+        requireRowComponents<AddedComponents...>();
+        return StorageIterator<AddedComponents...>(getAddedRange<AddedComponents>()...);
+    }
+
+    // Rows removed since the last flush, still holding their last values until the flush ends
+    template<typename... RemovedComponents>
+    auto getRemovedIterator() const {
+        requireRowComponents<RemovedComponents...>();
+        if (!storage.removedRows) {
+            std::println("Error: Removed rows were not kept for this archetype!");
+            std::exit(EXIT_FAILURE);
+        }
+        return std::as_const(*storage.removedRows).template getReferenceIterator<RemovedComponents...>();
+    }
+
+private:
+    template<typename... RowComponents>
+    void requireRowComponents() const {
+        auto rowMask = ComponentList<Components...>{}.template getComponentsMask<RowComponents...>();
+        if ((storage.archetypeMask & rowMask) != rowMask) {
+            std::println("Error: Observer batch iterated over a component without a column in this archetype!");
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    template<typename Type>
+    auto getAddedRange() {
+        auto& componentStorage = storage.components.template get<std::vector<Type>>();
+        return std::ranges::subrange(componentStorage.end() - static_cast<std::ptrdiff_t>(added), componentStorage.end());
+    }
+};
+
+template<typename... Components>
+struct MasterStorage {
+    static_assert(sizeof...(Components) <= 64, "Archetype masks hold at most 64 components");
+
+    // Archetypes with the same row mask but different shared values live under the same key
+    std::unordered_multimap<uint64_t, ComponentStorage<Components...>> masterMap;
+
+    // Singleton resources keyed by type; any type works, it does not take a component mask bit
+    using SingletonPointer = std::unique_ptr<void, void (*)(void*)>;
+    std::unordered_map<std::type_index, SingletonPointer> singletons;
+
+    using ObserverCallback = std::function<void(ObserverBatch<Components...>&)>;
+
+    // Called once per matching archetype on flushObservers, never per entity.
+    // Matches row components only, so every observed component has a column in the batch.
+    template<typename... ObservedComponents>
+    void observe(ObserverCallback callback) {
+        auto observedMask = ComponentList<Components...>{}.template getComponentsMask<ObservedComponents...>();
+        observers.emplace_back(observedMask, std::move(callback));
+        for (auto& [archetype, storage] : masterMap) {
+            storage.trackRemovedRows();
+        }
+    }
+
+    // Delivers this frame's events
+    void flushObservers() {
+        for (auto& [archetype, storage] : masterMap) {
+            if (storage.events.added == 0 && storage.events.removed == 0) {
+                continue;
+            }
+            ObserverBatch<Components...> batch{storage, storage.events.added, storage.events.removed};
+            for (auto& [observedMask, callback] : observers) {
+                if ((archetype & observedMask) == observedMask) {
+                    callback(batch);
+                }
+            }
+            storage.clearEvents();
+        }
+    }
+
+    void push(EntityBuilder<Components...>&& entity) {
+        auto archetype = entity.getArchetype();
+        if ((archetype & entity.getSharedArchetype()) != 0) {
+            std::println("Error: Component cannot be both shared and per entity!");
+            std::exit(EXIT_FAILURE);
+        }
+        auto* storage = findStorage(entity.getArchetypeHash(), [archetype, &entity](const auto& candidate) {
+            return candidate.archetypeMask == archetype && candidate.matchesShared(entity);
+        });
+        if (storage == nullptr) {
+            storage = &addStorage(ComponentStorage<Components...>{entity});
+        }
+        storage->push(std::move(entity));
+    }
+
+    template<typename Component, typename Key>
+    void sortBy(Key&& key) {
+        forEachStorageWith<Component>([&key](auto& storage) { storage.template sortBy<Component>(key); });
+    }
+
+    template<typename Component, typename Key>
+    void resortBy(Key&& key) {
+        forEachStorageWith<Component>([&key](auto& storage) { storage.template resortBy<Component>(key); });
+    }
+
+    // Column stream: blocks of {archetype mask, row count} followed by one raw column per component
+    // in the mask, in component list order. Native endianness, trivially copyable components only.
+    void loadColumns(std::istream& stream) {
+        ColumnBlockHeader header;
+        ComponentStorage<Components...>* storage = nullptr;
+        auto allComponentsMask = ComponentList<Components...>{}.template getComponentsMask<Components...>();
+        while (stream.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            if (header.archetypeMask == 0 || (header.archetypeMask & ~allComponentsMask) != 0) {
+                std::println("Error: Column stream block has an invalid archetype mask!");
+                std::exit(EXIT_FAILURE);
+            }
+            if (storage == nullptr || storage->archetypeMask != header.archetypeMask) {
+                storage = &getPlainStorage(header.archetypeMask);
+            }
+            storage->readColumns(stream, header.rows);
+        }
+        if (stream.gcount() != 0) {
+            std::println("Error: Unexpected end of the column stream!");
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    // Writes blocks of at most batchSize rows, so loading never grows a column by more than that at once
+    void saveColumns(std::ostream& stream, std::size_t batchSize) const {
+        if (batchSize == 0) {
+            std::println("Error: Column stream batch size must be at least 1!");
+            std::exit(EXIT_FAILURE);
+        }
+        // Checked up front so an unstreamable archetype never leaves a half written stream
+        for (const auto& [archetype, storage] : masterMap) {
+            if (!storage.canStreamColumns()) {
+                std::println("Error: Only archetypes of trivially copyable, non shared components can be streamed!");
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        for (const auto& [archetype, storage] : masterMap) {
+            for (std::size_t firstRow = 0; firstRow < storage.size(); firstRow += batchSize) {
+                ColumnBlockHeader header{archetype, std::min(batchSize, storage.size() - firstRow)};
+                stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                storage.writeColumns(stream, firstRow, header.rows);
+            }
+        }
+    }
+
+    // Moves a whole batch in; a new archetype takes the batch columns without copying
+    void merge(ComponentStorage<Components...>&& batch) {
+        auto* storage = findStorage(batch.getArchetypeHash(), [&batch](const auto& candidate) {
+            return candidate.matchesShared(batch);
+        });
+        if (storage == nullptr) {
+            addStorage(std::move(batch));
+        } else {
+            storage->append(std::move(batch));
+        }
+    }
+
+    // Removes rows matching the predicate from every archetype that has PredicateComponents.
+    // With parallel set archetypes are compacted on separate threads, so the predicate must be thread safe.
+    template<typename... PredicateComponents, typename Predicate>
+    std::size_t despawnIf(Predicate&& predicate, Compaction compaction = Compaction::Unstable, bool parallel = false) {
+        std::vector<ComponentStorage<Components...>*> storages;
+        forEachStorageWith<PredicateComponents...>([&storages](auto& storage) { storages.push_back(&storage); });
+        if (!parallel || storages.size() < 2) {
+            std::size_t despawned = 0;
+            for (auto* storage : storages) {
+                despawned += storage->template removeIf<PredicateComponents...>(predicate, compaction);
+            }
+            return despawned;
+        }
+
+        auto threadCount = std::min<std::size_t>(storages.size(), std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<std::size_t> despawned(threadCount);
+        {
+            std::vector<std::jthread> threads;
+            threads.reserve(threadCount);
+            for (std::size_t i = 0; i < threadCount; ++i) {
+                threads.emplace_back([&, i] {
+                    for (auto index = i; index < storages.size(); index += threadCount) {
+                        despawned[i] += storages[index]->template removeIf<PredicateComponents...>(predicate, compaction);
+                    }
+                });
+            }
+        }
+        return std::reduce(despawned.begin(), despawned.end());
+    }
+
+    // Removes rows matching the predicate and returns them as one batch per archetype
+    template<typename... ArchetypeComponents, typename Predicate>
+    auto extractIf(Predicate&& predicate) {
+        auto archetypeMask = ComponentList<Components...>{}.template getComponentsMask<ArchetypeComponents...>();
+        std::vector<ComponentStorage<Components...>> batches;
+        for (auto& [archetype, storage] : masterMap) {
+            if ((archetype & archetypeMask) != archetypeMask) {
+                continue;
+            }
+            auto batch = storage.makeEmpty();
+            // Walk backwards so filling holes with the last row never skips a row
+            for (auto row = storage.size(); row-- > 0;) {
+                if (predicate(storage.template getRow<ArchetypeComponents...>(row))) {
+                    storage.moveRowTo(row, batch);
+                }
+            }
+            if (batch.size() != 0) {
+                batches.emplace_back(std::move(batch));
+            }
+        }
+        return batches;
+    }
+
+    template<typename Resource>
+    auto& setSingleton(Resource&& resource) {
+        using Type = std::decay_t<Resource>;
+        SingletonPointer singleton{new Type(std::forward<Resource>(resource)), [](void* pointer) {
+            delete static_cast<Type*>(pointer);
+        }};
+        auto [it, inserted] = singletons.insert_or_assign(std::type_index{typeid(Type)}, std::move(singleton));
+        return *static_cast<Type*>(it->second.get());
+    }
+
+    template<typename Resource>
+    bool hasSingleton() const noexcept {
+        return singletons.contains(std::type_index{typeid(Resource)});
+    }
+
+    template<typename Resource>
+    Resource& getSingleton() noexcept {
+        return *static_cast<Resource*>(findSingleton<Resource>());
+    }
+
+    template<typename Resource>
+    const Resource& getSingleton() const noexcept {
+        return *static_cast<const Resource*>(findSingleton<Resource>());
+    }
+
+    // TODO: remove the need to use a double loop
+    template<typename... ArchetypeComponents>
+    auto getMasterIterator() {
+        auto archetypeMask = ComponentList<Components...>{}.template getComponentsMask<ArchetypeComponents...>();
+        return std::views::filter(masterMap, [archetypeMask](const auto& pair) {
+            return (pair.first & archetypeMask) == archetypeMask;
+        }) | std::views::transform([](auto& pair) {
+            return pair.second.template getReferenceIterator<ArchetypeComponents...>();
+        });
+    }
+
+    std::vector<std::pair<uint64_t, ObserverCallback>> observers;
+
+    // Points into masterMap nodes, which never move while the world exists
+    std::unordered_multimap<std::size_t, ComponentStorage<Components...>*> archetypeIndex;
+
+    template<typename Resource>
+    void* findSingleton() const noexcept {
+        auto it = singletons.find(std::type_index{typeid(Resource)});
+        if (it == singletons.end()) {
+            std::println("Error: Singleton was never set!");
+            std::exit(EXIT_FAILURE);
+        }
+        return it->second.get();
+    }
+
+    struct ColumnBlockHeader {
+        uint64_t archetypeMask;
+        uint64_t rows;
+    };
+
+    // Storage of the archetype without shared components
+    auto& getPlainStorage(uint64_t archetype) {
+        auto hash = hashArchetype<Components...>(archetype, 0, ValueList<std::optional<Components>...>{});
+        auto* storage = findStorage(hash, [archetype](const auto& candidate) {
+            return candidate.archetypeMask == archetype && candidate.sharedMask == 0;
+        });
+        if (storage == nullptr) {
+            storage = &addStorage(ComponentStorage<Components...>{archetype});
+        }
+        return *storage;
+    }
+
+    // Constant time lookup however many archetypes share a row mask; only hash collisions are compared
+    template<typename Matches>
+    ComponentStorage<Components...>* findStorage(std::size_t hash, Matches&& matches) {
+        auto [first, last] = archetypeIndex.equal_range(hash);
+        auto it = std::find_if(first, last, [&matches](const auto& pair) {
+            return matches(*pair.second);
+        });
+        return it == last ? nullptr : it->second;
+    }
+
+    ComponentStorage<Components...>& addStorage(ComponentStorage<Components...>&& storage) {
+        auto hash = storage.getArchetypeHash();
+        auto archetype = storage.archetypeMask;
+        auto& added = masterMap.emplace(archetype, std::move(storage))->second;
+        archetypeIndex.emplace(hash, &added);
+        if (!observers.empty()) {
+            added.trackRemovedRows();
+        }
+        return added;
+    }
+
+    template<typename... ArchetypeComponents, typename Function>
+    void forEachStorageWith(Function&& function) {
+        auto archetypeMask = ComponentList<Components...>{}.template getComponentsMask<ArchetypeComponents...>();
+        for (auto& [archetype, storage] : masterMap) {
+            if ((archetype & archetypeMask) == archetypeMask) {
+                function(storage);
+            }
+        }
+    }
+
+    template<typename SharedComponent, typename... ArchetypeComponents>
+    auto getSharedIterator() {
+        auto archetypeMask = ComponentList<Components...>{}.template getComponentsMask<ArchetypeComponents...>();
+        auto sharedMask = ComponentList<Components...>{}.template getComponentsMask<SharedComponent>();
+        return std::views::filter(masterMap, [archetypeMask, sharedMask](const auto& pair) {
+            return (pair.first & archetypeMask) == archetypeMask && (pair.second.sharedMask & sharedMask) == sharedMask;
+        }) | std::views::transform([](auto& pair) {
+            return SharedChunk<SharedComponent, ArchetypeComponents...>{
+                pair.second.template getShared<SharedComponent>(),
+                pair.second.template getReferenceIterator<ArchetypeComponents...>()
+            };
+        });
+    }
+};
+
+// Independent worlds, each owned by a long-lived worker thread
+template<typename... Components>
+struct ShardedStorage {
+    using ShardSystem = std::function<void(std::size_t, MasterStorage<Components...>&)>;
+
+    explicit ShardedStorage(std::size_t shardCount) : shards(shardCount) {
+        for (std::size_t i = 0; i < shardCount; ++i) {
+            transferQueues.emplace_back(std::make_unique<TransferQueue>());
+        }
+        workers.reserve(shardCount);
+        for (std::size_t i = 0; i < shardCount; ++i) {
+            workers.emplace_back([this, i] { runShard(i); });
+        }
+    }
+
+    ShardedStorage(const ShardedStorage&) = delete;
+    ShardedStorage& operator=(const ShardedStorage&) = delete;
+
+    ~ShardedStorage() {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        workReady.notify_all();
+        workers.clear();
+    }
+
+    // Hands system(shardIndex, shard) to every shard worker and waits for all of them
+    void run(ShardSystem system) {
+        std::unique_lock lock{mutex};
+        currentSystem = &system;
+        pendingShards = shards.size();
+        ++generation;
+        workReady.notify_all();
+        workDone.wait(lock, [this] { return pendingShards == 0; });
+        currentSystem = nullptr;
+    }
+
+    // Called from the source shard thread; rows reach the target on its next flushTransfers
+    template<typename... ArchetypeComponents, typename Predicate>
+    void transferIf(std::size_t sourceShard, std::size_t targetShard, Predicate&& predicate) {
+        auto batches = shards[sourceShard].template extractIf<ArchetypeComponents...>(std::forward<Predicate>(predicate));
+        if (batches.empty()) {
+            return;
+        }
+        auto& queue = *transferQueues[targetShard];
+        std::lock_guard lock{queue.mutex};
+        std::ranges::move(batches, std::back_inserter(queue.batches));
+    }
+
+    // Called from the target shard thread
+    void flushTransfers(std::size_t shard) {
+        std::vector<ComponentStorage<Components...>> batches;
+        {
+            auto& queue = *transferQueues[shard];
+            std::lock_guard lock{queue.mutex};
+            batches.swap(queue.batches);
+        }
+        for (auto& batch : batches) {
+            shards[shard].merge(std::move(batch));
+        }
+    }
+
+    // Read-only query over every shard; no shard thread may be running meanwhile
+    template<typename... ArchetypeComponents>
+    auto getMergedIterator() {
+        return shards | std::views::transform([](auto& shard) {
+            return shard.template getMasterIterator<ArchetypeComponents...>();
+        }) | std::views::join;
+    }
+
+    std::vector<MasterStorage<Components...>> shards;
+
+private:
+    struct TransferQueue {
+        std::mutex mutex;
+        std::vector<ComponentStorage<Components...>> batches;
+    };
+
+    void runShard(std::size_t shard) {
+        std::size_t seenGeneration = 0;
+        std::unique_lock lock{mutex};
+        while (true) {
+            workReady.wait(lock, [this, seenGeneration] { return stopping || generation != seenGeneration; });
+            if (stopping) {
+                return;
+            }
+            seenGeneration = generation;
+            auto* system = currentSystem;
+            lock.unlock();
+            (*system)(shard, shards[shard]);
+            lock.lock();
+            if (--pendingShards == 0) {
+                workDone.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<TransferQueue>> transferQueues;
+
+    std::mutex mutex;
+    std::condition_variable workReady;
+    std::condition_variable workDone;
+    ShardSystem* currentSystem = nullptr;
+    std::size_t pendingShards = 0;
+    std::size_t generation = 0;
+    bool stopping = false;
+
+    // Declared last so the threads are joined before the state they use is destroyed
+    std::vector<std::jthread> workers;
+};
+
+// Read-only columns of one frame, handed from the simulation to the pipeline consumers
+template<typename... Components>
+struct FrameSnapshot {
+    // Only components passed to submit were copied; asking for any other one is an error, not an empty result
+    template<typename... ArchetypeComponents>
+    auto getIterator() const {
+        auto queryMask = ComponentList<Components...>{}.template getComponentsMask<ArchetypeComponents...>();
+        if ((extractedMask & queryMask) != queryMask) {
+            std::println("Error: Frame snapshot queried for a component that was not extracted!");
+            std::exit(EXIT_FAILURE);
+        }
+        return std::views::take(storages, static_cast<std::ptrdiff_t>(storageCount)) | std::views::transform([](const auto& storage) {
+            return storage.template getReferenceIterator<ArchetypeComponents...>();
+        });
+    }
+
+    std::size_t frame = 0;
+    std::size_t storageCount = 0;
+    uint64_t extractedMask = {0};
+    // Kept between frames so column capacity is reused when the snapshot comes back to the pipeline
+    std::vector<ComponentStorage<Components...>> storages;
+};
+
+// Runs consumers of frame N on their own threads while the caller already simulates frame N+1.
+// Snapshot buffers move between the simulation and the consumers and are recycled, never reallocated
+// once warmed up; the simulation keeps ownership of its columns since it still needs them next frame.
+template<typename... Components>
+struct FramePipeline {
+    // Consumers run concurrently on the same snapshot, so they only get read access
+    using Consumer = std::function<void(const FrameSnapshot<Components...>&)>;
+
+    // depth is the number of frames the consumers may lag behind the simulation
+    FramePipeline(std::size_t depth, std::vector<Consumer> consumers) : depth{std::max<std::size_t>(depth, 1)}, consumers{std::move(consumers)} {
+        workers.reserve(this->consumers.size());
+        for (std::size_t i = 0; i < this->consumers.size(); ++i) {
+            workers.emplace_back([this, i] { runConsumer(i); });
+        }
+    }
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    ~FramePipeline() {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        frameReady.notify_all();
+        workers.clear();
+    }
+
+    // Snapshots ExtractComponents of every archetype that has them, blocks while depth frames are in flight
+    template<typename... ExtractComponents>
+    void submit(MasterStorage<Components...>& storage) {
+        if (consumers.empty()) {
+            return;
+        }
+        FrameSnapshot<Components...> snapshot;
+        {
+            std::unique_lock lock{mutex};
+            frameDone.wait(lock, [this] { return frames.size() < depth; });
+            if (!freeSnapshots.empty()) {
+                snapshot = std::move(freeSnapshots.back());
+                freeSnapshots.pop_back();
+            }
+        }
+
+        snapshot.frame = nextFrame;
+        snapshot.storageCount = 0;
+        snapshot.extractedMask = ComponentList<Components...>{}.template getComponentsMask<ExtractComponents...>();
+        storage.template forEachStorageWith<ExtractComponents...>([&snapshot](const auto& archetypeStorage) {
+            if (snapshot.storageCount == snapshot.storages.size()) {
+                snapshot.storages.emplace_back(archetypeStorage.archetypeMask);
+            }
+            snapshot.storages[snapshot.storageCount++].template copyColumnsFrom<ExtractComponents...>(archetypeStorage);
+        });
+
+        {
+            std::lock_guard lock{mutex};
+            frames.push_back(PendingFrame{std::move(snapshot), consumers.size()});
+            ++nextFrame;
+        }
+        frameReady.notify_all();
+    }
+
+    // Waits until the consumers are done with every submitted frame
+    void finish() {
+        std::unique_lock lock{mutex};
+        frameDone.wait(lock, [this] { return frames.empty(); });
+    }
+
+private:
+    struct PendingFrame {
+        FrameSnapshot<Components...> snapshot;
+        std::size_t remainingConsumers;
+    };
+
+    void runConsumer(std::size_t consumer) {
+        std::size_t frame = 0;
+        std::unique_lock lock{mutex};
+        while (true) {
+            frameReady.wait(lock, [this, frame] { return stopping || frame < oldestFrame + frames.size(); });
+            if (frame >= oldestFrame + frames.size()) {
+                return;
+            }
+            // References into the deque stay valid, the front is only popped once every consumer is done
+            auto& pendingFrame = frames[frame - oldestFrame];
+            lock.unlock();
+            consumers[consumer](pendingFrame.snapshot);
+            lock.lock();
+            --pendingFrame.remainingConsumers;
+            ++frame;
+            bool released = false;
+            while (!frames.empty() && frames.front().remainingConsumers == 0) {
+                freeSnapshots.push_back(std::move(frames.front().snapshot));
+                frames.pop_front();
+                ++oldestFrame;
+                released = true;
+            }
+            if (released) {
+                frameDone.notify_all();
+            }
+        }
+    }
+
+    std::size_t depth;
+    std::vector<Consumer> consumers;
+
+    std::mutex mutex;
+    std::condition_variable frameReady;
+    std::condition_variable frameDone;
+    std::deque<PendingFrame> frames;
+    std::vector<FrameSnapshot<Components...>> freeSnapshots;
+    std::size_t oldestFrame = 0;
+    std::size_t nextFrame = 0;
+    bool stopping = false;
+
+    // Declared last so the threads are joined before the state they use is destroyed
+    std::vector<std::jthread> workers;
+};
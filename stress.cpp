@@ -0,0 +1,82 @@
+#include <cstdint>
+#include <iostream>
+#include <utility>
+
+#include "ecs.hpp"
+
+// Compile-time stress test: a world with as many component types as an archetype mask can hold,
+// plus the type list lookups on their own at the component counts real projects reach.
+// Build time of this target is the number to watch when touching the template machinery.
+constexpr std::size_t StressComponentCount = 64;
+constexpr std::size_t StressTypeCount = 300;
+
+template<std::size_t Index>
+struct StressComponent {
+    uint32_t value;
+};
+
+template<std::size_t... Indices>
+auto makeStressWorld(std::index_sequence<Indices...>) -> MasterStorage<StressComponent<Indices>...>;
+
+template<std::size_t... Indices>
+auto makeStressEntity(std::index_sequence<Indices...>) -> EntityBuilder<StressComponent<Indices>...>;
+
+using StressWorld = decltype(makeStressWorld(std::make_index_sequence<StressComponentCount>{}));
+using StressEntity = decltype(makeStressEntity(std::make_index_sequence<StressComponentCount>{}));
+
+template<std::size_t... Indices>
+void pushStressEntities(StressWorld& world, std::index_sequence<Indices...>) {
+    for (uint32_t i = 0; i < 4; ++i) {
+        StressEntity entity;
+        ((Indices % 4 == i ? (void)entity.withComponent(StressComponent<Indices>{i}) : (void)0), ...);
+        world.push(std::move(entity));
+    }
+}
+
+template<std::size_t... Indices>
+uint64_t sumStressComponents(StressWorld& world, std::index_sequence<Indices...>) {
+    uint64_t sum = 0;
+    auto sumComponent = [&world, &sum]<std::size_t Index>() {
+        for (auto z : world.getMasterIterator<StressComponent<Index>>()) {
+            for (auto x : z) {
+                sum += x.template get<const StressComponent<Index>&>().value;
+            }
+        }
+    };
+    (sumComponent.template operator()<Indices>(), ...);
+    return sum;
+}
+
+// ValueList, ComponentList and getTypeIndex do not depend on the 64 bit mask, so they get the full count
+template<std::size_t... Indices>
+auto makeStressValues(std::index_sequence<Indices...>) -> ValueList<StressComponent<Indices>...>;
+
+template<std::size_t... Indices>
+auto makeStressList(std::index_sequence<Indices...>) -> ComponentList<StressComponent<Indices>...>;
+
+using StressValues = decltype(makeStressValues(std::make_index_sequence<StressTypeCount>{}));
+using StressList = decltype(makeStressList(std::make_index_sequence<StressTypeCount>{}));
+
+template<std::size_t... Indices>
+uint64_t sumStressValues(std::index_sequence<Indices...>) {
+    StressValues values{StressComponent<Indices>{static_cast<uint32_t>(Indices)}...};
+    return (static_cast<uint64_t>(values.template get<StressComponent<Indices>>().value) + ...);
+}
+
+template<std::size_t... Indices>
+consteval bool checkStressLookups(std::index_sequence<Indices...>) {
+    return ((getTypeIndex<StressComponent<Indices>, StressComponent<Indices>...>() == Indices) && ...)
+        && ((StressList{}.template getComponentIndex<StressComponent<Indices>>() == StressTypeCount - 1 - Indices) && ...)
+        && StressList{}.intersects(ComponentList<StressComponent<StressTypeCount - 1>>{});
+}
+
+static_assert(checkStressLookups(std::make_index_sequence<StressTypeCount>{}));
+
+int main() {
+    StressWorld world;
+    pushStressEntities(world, std::make_index_sequence<StressComponentCount>{});
+    std::cout << "Archetypes:\t" << world.masterMap.size() << std::endl;
+    std::cout << "Sum:\t" << sumStressComponents(world, std::make_index_sequence<StressComponentCount>{}) << std::endl;
+    std::cout << "Value sum:\t" << sumStressValues(std::make_index_sequence<StressTypeCount>{}) << std::endl;
+    return 0;
+}